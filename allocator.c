@@ -8,10 +8,17 @@
 //
 
 #include "allocator.h"
+#include "vlad_snapshot.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <execinfo.h>
 
 #define FREE_HEADER_SIZE  sizeof(struct free_list_header)  
 #define ALLOC_HEADER_SIZE sizeof(struct alloc_block_header)  
@@ -22,10 +29,23 @@
 #define WORST_FIT      2
 #define RANDOM_FIT     3
 
+#define SNAPSHOT_BATCH 512   // regions buffered per write() by vlad_snapshot()
+
+#define PROFILE_RATE   (512*1024)  // default mean # bytes between heap profile samples
+#define PROFILE_BITS   12          // log2 of the # live samples the profiler can hold
+#define PROFILE_SLOTS  (1 << PROFILE_BITS)
+#define PROFILE_EMPTY  0xFFFFFFFF  // profile_keys[] entry for an unused slot
+#define PROFILE_DEPTH  32          // stack frames kept per sample
+
 #define TRUE           1
 #define FALSE          0
 #define DEBUGGING      0
 
+// validate headers in vlad_free_sized() and vlad_usable_size()
+#ifndef CHECKING
+#define CHECKING       1
+#endif
+
 typedef unsigned char byte;
 typedef u_int32_t vsize_t;
 typedef u_int32_t vlink_t;
@@ -43,16 +63,42 @@ typedef struct alloc_block_header {
    vsize_t size;     // # bytes in this block (including header)
 } alloc_header_t;
 
+typedef struct profile_sample {
+   u_int32_t n;                 // # bytes the client asked for
+   int depth;                   // # frames in stack
+   void *stack[PROFILE_DEPTH];  // return addresses, innermost first
+} profile_sample_t;
+
 // Global data
 
 static byte *memory = NULL;   // pointer to start of allocator memory
 static vaddr_t free_list_ptr; // index in memory[] of first block in free list
 static vsize_t memory_size;   // number of bytes malloc'd in memory[]
 static u_int32_t strategy;    // allocation strategy (by default BEST_FIT)
+static vaddr_t fresh_ptr;     // index in memory[] from which every byte is still zero
+
+// Heap profiler state; samples live outside memory[], in a hash table
+// keyed by the sampled block's index. The keys are kept apart from the
+// samples so that the lookup on every vlad_free() only scans them.
+
+static u_int32_t profile_rate = 0;   // mean # bytes between samples (0 = off)
+static u_int32_t profile_sample_rate = 0;  // rate of the samples in profile_table (0 = never started)
+static int64_t profile_countdown;    // # bytes until the next sample
+static u_int64_t profile_seed;       // state of the sampling random number generator
+static u_int32_t profile_live = 0;   // # samples in profile_table
+static u_int32_t profile_dropped;    // # samples lost because profile_table was full
+static vaddr_t profile_keys[PROFILE_SLOTS];  // sampled block's header index, or PROFILE_EMPTY
+static profile_sample_t profile_table[PROFILE_SLOTS];
 
 // Private functions
 
 static void vlad_merge();
+static void vlad_release(alloc_header_t *alloc_ptr);
+static int write_all(int fd, void *buf, size_t n);
+static void profile_record(vaddr_t region, u_int32_t n);
+static void profile_forget(vaddr_t region);
+static int64_t profile_gap(void);
+static u_int32_t profile_home(vaddr_t region);
 int isPowerOf2(int num);
 int numRegions(u_int32_t magic);
 
@@ -85,9 +131,9 @@ void vlad_init(u_int32_t size)
    if (DEBUGGING)
       printf("memory_size = %d\n", memory_size);
    
-   // dummy statements to keep compiler happy
-   // remove them when you implement your solution
-   memory = (byte *) malloc(memory_size);
+   // calloc() so that vlad_calloc() knows untouched memory is zero; for
+   // a chunk this size the system usually maps fresh pages anyway
+   memory = (byte *) calloc(1, memory_size);
    
    if (DEBUGGING)
       printf("memory = %p\n\n",memory);
@@ -110,6 +156,9 @@ void vlad_init(u_int32_t size)
    
    // setting the free list pointer to point to the header of the only free block
    free_list_ptr = 0;
+   
+   // nothing past that header has been written yet
+   fresh_ptr = FREE_HEADER_SIZE;
 }
 
 
@@ -125,6 +174,10 @@ void *vlad_malloc(u_int32_t n)
 {
    if (DEBUGGING) printf("CALLED VLAD_MALLOC\n");
    
+   // a request this big can never fit, and adding the header to it below
+   // could wrap around to a small size
+   if (n >= memory_size) return NULL;
+   
    // setting the number of bytes minimum that the allocated region must contain
    u_int32_t bytes = ALLOC_HEADER_SIZE + n;
    
@@ -230,6 +283,10 @@ void *vlad_malloc(u_int32_t n)
             new_prev_ptr->next = best_free_ptr->next;
             new_next_ptr->prev = best_free_ptr->prev;
             
+            // the whole region now belongs to the client
+            if (fresh_ptr < free_index + alloc_ptr->size)
+               fresh_ptr = free_index + alloc_ptr->size;
+            
          } else {
             if (DEBUGGING)
                printf("  it is the only region so can't allocate whole region\n");
@@ -289,6 +346,9 @@ void *vlad_malloc(u_int32_t n)
          rtnPtr = (byte *) alloc_ptr + ALLOC_HEADER_SIZE;
          if (still_at_start) free_list_ptr += bytes;
          
+         // the client's region and the new free header after it are both dirty
+         if (fresh_ptr < free_index + bytes + FREE_HEADER_SIZE)
+            fresh_ptr = free_index + bytes + FREE_HEADER_SIZE;
       }
       
       if (DEBUGGING){
@@ -425,10 +485,54 @@ void *vlad_malloc(u_int32_t n)
    */
    // ============================================================================
    
+   // heap profiler: count down the bytes handed out and take a sample each
+   // time the count runs out
+   if (profile_rate != 0 && rtnPtr != NULL){
+      profile_countdown -= n;
+      if (profile_countdown < 0)
+         profile_record((vaddr_t) (rtnPtr - memory) - ALLOC_HEADER_SIZE, n);
+   }
+   
    return (void *) rtnPtr;
 }
 
 
+// Input: nmemb, size - number and size of elements requested
+// Output: p - a pointer, or NULL
+// Precondition: as for vlad_malloc(nmemb * size)
+// Postcondition: as for vlad_malloc(nmemb * size), and the first
+//                nmemb * size bytes at p are all zero
+//
+// (Only the part of the region below fresh_ptr is cleared; memory past it
+//  has never been written since vlad_init(), so calloc() left it zero)
+
+void *vlad_calloc(u_int32_t nmemb, u_int32_t size)
+{
+   if (DEBUGGING) printf("CALLED VLAD_CALLOC\n");
+   
+   // nmemb * size must not wrap around; vlad_malloc() rejects anything
+   // too big for memory[], so start + n below cannot wrap either
+   if (size != 0 && nmemb > UINT32_MAX / size) return NULL;
+   u_int32_t n = nmemb * size;
+   
+   // vlad_malloc() moves fresh_ptr past whatever it hands out
+   vaddr_t known_zero = fresh_ptr;
+   
+   byte *object = (byte *) vlad_malloc(n);
+   if (object == NULL) return NULL;
+   
+   vaddr_t start = object - memory;
+   vaddr_t end = start + n;
+   if (end > known_zero) end = known_zero;
+   
+   if (DEBUGGING) printf("clearing %d of %d bytes\n", (start < end) ? end - start : 0, n);
+   
+   if (start < end) memset(object, 0, end - start);
+   
+   return object;
+}
+
+
 // Input: object, a pointer.
 // Output: none
 // Precondition: object points to a location immediately after a header block
@@ -462,122 +566,192 @@ void vlad_free(void *object)
    if (alloc_ptr->magic != MAGIC_ALLOC){
       fprintf(stderr, "vlad_free: Attempt to free non-allocated memory\n");
       exit(EXIT_FAILURE);
-   } else {
-      // re-defining the free_header of the ex-allocated memory
-      free_header_t *new_free_ptr = (free_header_t *) alloc_ptr;
-      vaddr_t new_free_ptr_index = (vaddr_t) new_free_ptr - (vaddr_t) memory;
-      new_free_ptr->magic = MAGIC_FREE;
-      
-      
-      // finding pointers to the free regions adjacent to pointed one
-      free_header_t *free_ptr = (free_header_t *) (memory + free_list_ptr);
+   }
+   
+   vlad_release(alloc_ptr);
+}
+
+
+// Input: object, a pointer; n, the number of bytes the caller asked for
+//        (or anything up to vlad_usable_size(object))
+// Output: none
+// Precondition: object points to a location immediately after a header block
+//               within the allocator's memory, for a region of at least n bytes
+// Postcondition: as for vlad_free()
+//
+// (With CHECKING off the header is trusted as-is and not validated)
+
+void vlad_free_sized(void *object, u_int32_t n)
+{
+   if (DEBUGGING) printf("CALLED VLAD_FREE_SIZED\n");
+   
+   alloc_header_t *alloc_ptr = (alloc_header_t *) object - 1;
+   
+   if (CHECKING){
+      if (object == NULL){
+         fprintf(stderr,"cannot free null pointer\n");
+         exit(EXIT_FAILURE);
+      }
+      if (alloc_ptr->magic != MAGIC_ALLOC){
+         fprintf(stderr, "vlad_free_sized: Attempt to free non-allocated memory\n");
+         exit(EXIT_FAILURE);
+      }
+      // the region must have room for what the caller thinks it holds
+      if (n > alloc_ptr->size - ALLOC_HEADER_SIZE){
+         fprintf(stderr, "vlad_free_sized: Size %d does not match region of %d bytes\n",
+                 n, alloc_ptr->size);
+         exit(EXIT_FAILURE);
+      }
+   }
+   
+   vlad_release(alloc_ptr);
+}
+
+
+// Input: object, a pointer
+// Output: number of bytes the client may use at object
+// Precondition: object points to a location immediately after a header block
+//               within the allocator's memory
+//
+// (This can be more than was asked for: requests are rounded up to a
+//  multiple of 4, and a whole free region is handed out when splitting
+//  it would leave too little behind)
+
+u_int32_t vlad_usable_size(void *object)
+{
+   alloc_header_t *alloc_ptr = (alloc_header_t *) object - 1;
+   
+   if (CHECKING && alloc_ptr->magic != MAGIC_ALLOC){
+      fprintf(stderr, "vlad_usable_size: Not an allocated region\n");
+      exit(EXIT_FAILURE);
+   }
+   
+   return alloc_ptr->size - ALLOC_HEADER_SIZE;
+}
+
+
+// Input: alloc_ptr, the header of an allocated region
+// Postcondition: the region has been placed in the free list and merged
+//                with any adjacent free blocks
+
+static void vlad_release(alloc_header_t *alloc_ptr)
+{
+   // re-defining the free_header of the ex-allocated memory
+   free_header_t *new_free_ptr = (free_header_t *) alloc_ptr;
+   vaddr_t new_free_ptr_index = (vaddr_t) new_free_ptr - (vaddr_t) memory;
+   new_free_ptr->magic = MAGIC_FREE;
+   
+   // a sampled block is no longer live
+   if (profile_live != 0) profile_forget(new_free_ptr_index);
+   
+   
+   // finding pointers to the free regions adjacent to pointed one
+   free_header_t *free_ptr = (free_header_t *) (memory + free_list_ptr);
+   
+   if (DEBUGGING){
+      printf(" free_list_ptr (free_ptr) is at %p or index %d\n",free_ptr,free_list_ptr);
+      printf(" newly freed region (new_free_ptr) at %p or index %d\n", new_free_ptr, new_free_ptr_index);
+   }
+   
+   if (free_ptr->next == free_list_ptr){
+      // case 1: where the free_list_pointed region is the only free list
+      free_ptr->next = (vaddr_t) new_free_ptr - (vaddr_t) memory;
+      free_ptr->prev = free_ptr->next;
+      new_free_ptr->next = free_list_ptr;
+      new_free_ptr->prev = new_free_ptr->next;
       
       if (DEBUGGING){
-         printf(" free_list_ptr (free_ptr) is at %p or index %d\n",free_ptr,free_list_ptr);
-         printf(" newly freed region (new_free_ptr) at %p or index %d\n", new_free_ptr, new_free_ptr_index);
+         printf("\tfirst free region: next = %d, prev = %d\n",free_ptr->next,free_ptr->prev);
+         printf("\tnew free region: next = %d, prev = %d\n",new_free_ptr->next,new_free_ptr->prev);
+         printf("\tnew free region size = %d\n",new_free_ptr->size);
       }
       
-      if (free_ptr->next == free_list_ptr){
-         // case 1: where the free_list_pointed region is the only free list
-         free_ptr->next = (vaddr_t) new_free_ptr - (vaddr_t) memory;
-         free_ptr->prev = free_ptr->next;
-         new_free_ptr->next = free_list_ptr;
-         new_free_ptr->prev = new_free_ptr->next;
-         
-         if (DEBUGGING){
-            printf("\tfirst free region: next = %d, prev = %d\n",free_ptr->next,free_ptr->prev);
-            printf("\tnew free region: next = %d, prev = %d\n",new_free_ptr->next,new_free_ptr->prev);
-            printf("\tnew free region size = %d\n",new_free_ptr->size);
-         }
-         
-      } else {
-         // case 2: where there are multiple free regions, hence need to cycle through
-         
-         // tracking pointer for cycling through free region list
-         free_header_t* curr = free_ptr;
-         free_header_t* next;
-         free_header_t* prev;
-         
-         // indicators for the special case where the new free isn't between any two adgacent
-         // free regions
-         int lowest = FALSE;
-         int highest = FALSE;
-         
-         // case 2.1: where the first free region is higher in memory than newly freed region
-         if (free_ptr > new_free_ptr){
-            // hence, track backwards until free region (curr) is less than new free region
-            do {
-               if (DEBUGGING) printf("case 2.1: curr is %d\n",(vaddr_t)curr - (vaddr_t)memory);
-               curr = (free_header_t *) (memory + curr->prev);
-            } while ( !(curr == free_ptr || curr < new_free_ptr) );
-            
-            // if the current free pointer is still greater than the new free pointer, then all
-            // the free regions are higher than the new one, which is then the lowest
-            if (curr > new_free_ptr) lowest = TRUE;
-
-         // case 2.2: where the first free region is lower in memory than newly freed region
-         } else if (free_ptr < new_free_ptr){
-            // hence, track forwards until free region is higher than new free region
-            do {
-               if (DEBUGGING) printf("case 2.2: curr is %d\n",(vaddr_t)curr - (vaddr_t)memory);
-               curr = (free_header_t *) (memory + curr->next);
-            } while ( !(curr == free_ptr || curr > new_free_ptr) );
-
-            // if the current free pointer is still less than the new free pointer, then all
-            // the free regions are lower than the new one, which is then the highest
-            if (curr < new_free_ptr) highest = TRUE;
-         }
-         
-         // if curr is pointing to the region just after new free need to get address of previous free
-         //
-         // if the new free region is the lowest or highest, curr will always stop at free_list_ptr
-         // which is always the next of both those cases.
-         if (curr > new_free_ptr || lowest || highest){
-            prev = (free_header_t *) (memory + curr->prev);
-            next = curr;
-            
-         // else if curr is pointing to the region just before new free
-         // need to get address of next free
-         } else if (curr < new_free_ptr){
-            next = (free_header_t *) (memory + curr->next);
-            prev = curr;
-         }
-         
-         // after getting pointers to next and prev, add new free between them
-         new_free_ptr->next = (vaddr_t) next - (vaddr_t) memory;
-         new_free_ptr->prev = (vaddr_t) prev - (vaddr_t) memory;
-         prev->next = (vaddr_t) new_free_ptr - (vaddr_t) memory;
-         next->prev = (vaddr_t) new_free_ptr - (vaddr_t) memory;
-         
-         if (DEBUGGING){
-            printf(" pointer to surroundings:");
-            printf(" next = %d, prev = %d\n",new_free_ptr->next,new_free_ptr->prev);
-            
-            printf(" next and prev's reciprocating pointers:");
-            printf(" next->prev = %d ,", ((free_header_t *)(memory+new_free_ptr->next)) -> prev);
-            printf(" prev->next = %d\n", ((free_header_t *)(memory+new_free_ptr->prev)) -> next);
-         }
-      }
+   } else {
+      // case 2: where there are multiple free regions, hence need to cycle through
       
+      // tracking pointer for cycling through free region list
+      free_header_t* curr = free_ptr;
+      free_header_t* next;
+      free_header_t* prev;
       
-      // finding index of newly freed memory to set free_list_ptr to it if it is
-      // greater than this value
-      vaddr_t new_free_index = (vaddr_t) new_free_ptr - (vaddr_t) memory;
+      // indicators for the special case where the new free isn't between any two adgacent
+      // free regions
+      int lowest = FALSE;
+      int highest = FALSE;
       
-      if (DEBUGGING){
-         printf("free_index = %d\n",new_free_index);
-         printf("free_list_ptr = %d\n",free_list_ptr);
+      // case 2.1: where the first free region is higher in memory than newly freed region
+      if (free_ptr > new_free_ptr){
+         // hence, track backwards until free region (curr) is less than new free region
+         do {
+            if (DEBUGGING) printf("case 2.1: curr is %d\n",(vaddr_t)curr - (vaddr_t)memory);
+            curr = (free_header_t *) (memory + curr->prev);
+         } while ( !(curr == free_ptr || curr < new_free_ptr) );
+         
+         // if the current free pointer is still greater than the new free pointer, then all
+         // the free regions are higher than the new one, which is then the lowest
+         if (curr > new_free_ptr) lowest = TRUE;
+
+      // case 2.2: where the first free region is lower in memory than newly freed region
+      } else if (free_ptr < new_free_ptr){
+         // hence, track forwards until free region is higher than new free region
+         do {
+            if (DEBUGGING) printf("case 2.2: curr is %d\n",(vaddr_t)curr - (vaddr_t)memory);
+            curr = (free_header_t *) (memory + curr->next);
+         } while ( !(curr == free_ptr || curr > new_free_ptr) );
+
+         // if the current free pointer is still less than the new free pointer, then all
+         // the free regions are lower than the new one, which is then the highest
+         if (curr < new_free_ptr) highest = TRUE;
       }
       
-      if (free_list_ptr > new_free_index) {
-         free_list_ptr = new_free_index;
+      // if curr is pointing to the region just after new free need to get address of previous free
+      //
+      // if the new free region is the lowest or highest, curr will always stop at free_list_ptr
+      // which is always the next of both those cases.
+      if (curr > new_free_ptr || lowest || highest){
+         prev = (free_header_t *) (memory + curr->prev);
+         next = curr;
+         
+      // else if curr is pointing to the region just before new free
+      // need to get address of next free
+      } else if (curr < new_free_ptr){
+         next = (free_header_t *) (memory + curr->next);
+         prev = curr;
       }
       
-      if (DEBUGGING)
-         printf("now free_list_ptr = %d\n",free_list_ptr);
+      // after getting pointers to next and prev, add new free between them
+      new_free_ptr->next = (vaddr_t) next - (vaddr_t) memory;
+      new_free_ptr->prev = (vaddr_t) prev - (vaddr_t) memory;
+      prev->next = (vaddr_t) new_free_ptr - (vaddr_t) memory;
+      next->prev = (vaddr_t) new_free_ptr - (vaddr_t) memory;
       
+      if (DEBUGGING){
+         printf(" pointer to surroundings:");
+         printf(" next = %d, prev = %d\n",new_free_ptr->next,new_free_ptr->prev);
+         
+         printf(" next and prev's reciprocating pointers:");
+         printf(" next->prev = %d ,", ((free_header_t *)(memory+new_free_ptr->next)) -> prev);
+         printf(" prev->next = %d\n", ((free_header_t *)(memory+new_free_ptr->prev)) -> next);
+      }
    }
    
+   
+   // finding index of newly freed memory to set free_list_ptr to it if it is
+   // greater than this value
+   vaddr_t new_free_index = (vaddr_t) new_free_ptr - (vaddr_t) memory;
+   
+   if (DEBUGGING){
+      printf("free_index = %d\n",new_free_index);
+      printf("free_list_ptr = %d\n",free_list_ptr);
+   }
+   
+   if (free_list_ptr > new_free_index) {
+      free_list_ptr = new_free_index;
+   }
+   
+   if (DEBUGGING)
+      printf("now free_list_ptr = %d\n",free_list_ptr);
+   
    if (DEBUGGING) { printf("\n"); vlad_stats(); }
    
    vlad_merge();
@@ -655,6 +829,10 @@ void vlad_end(void)
    if (memory != NULL)
       free(memory);
    memory = NULL;
+   
+   // samples refer to indexes in the old memory[]
+   if (profile_live != 0) memset(profile_keys, 0xFF, sizeof(profile_keys));
+   profile_live = 0;
 }
 
 
@@ -760,6 +938,269 @@ void vlad_stats(void)
    return;
 }
 
+// Input: fd, a file descriptor open for writing
+// Output: 0 on success, -1 if a write failed or memory[] is corrupt
+// Precondition: allocator has been vlad_init()'d
+// Postcondition: a description of every region, in the format given in
+//                vlad_snapshot.h, has been written to fd
+//
+// (Regions are found by stepping from header to header through memory[],
+//  so this is a single pass; only SNAPSHOT_BATCH records are held at once)
+
+int vlad_snapshot(int fd)
+{
+   if (DEBUGGING) printf("CALLED VLAD_SNAPSHOT\n");
+   
+   snapshot_header_t header;
+   header.magic = SNAPSHOT_MAGIC;
+   header.version = SNAPSHOT_VERSION;
+   header.memory_size = memory_size;
+   header.free_list_ptr = free_list_ptr;
+   if (write_all(fd, &header, sizeof(header)) < 0) return -1;
+   
+   snapshot_record_t batch[SNAPSHOT_BATCH];
+   int used = 0;
+   
+   vaddr_t curr = 0;
+   while (curr < memory_size){
+      // both kinds of header keep the magic and size in the same place
+      free_header_t *region = (free_header_t *) (memory + curr);
+      
+      // a size that is zero, not a multiple of 4 or runs off the end
+      // would send the walk to an offset that is not a header
+      if ((region->magic != MAGIC_FREE && region->magic != MAGIC_ALLOC) || region->size == 0
+          || region->size % 4 != 0 || region->size > memory_size - curr){
+         fprintf(stderr, "vlad_snapshot: Memory corruption at index %d\n", curr);
+         return -1;
+      }
+      
+      batch[used].offset = curr;
+      batch[used].size = region->size | ((region->magic == MAGIC_FREE) ? SNAPSHOT_FREE : 0);
+      used++;
+      
+      if (used == SNAPSHOT_BATCH){
+         if (write_all(fd, batch, used*sizeof(snapshot_record_t)) < 0) return -1;
+         used = 0;
+      }
+      
+      curr += region->size;
+   }
+   
+   // a zero-sized record marks the end
+   batch[used].offset = memory_size;
+   batch[used].size = 0;
+   used++;
+   
+   return write_all(fd, batch, used*sizeof(snapshot_record_t));
+}
+
+// Input: sample_bytes - mean number of bytes allocated between samples,
+//        or 0 for PROFILE_RATE
+// Output: none
+// Postcondition: vlad_malloc() records the stack of roughly one
+//                allocation every sample_bytes bytes, until
+//                vlad_heap_profile_stop()
+//
+// (The gap between samples is drawn at random from an exponential
+//  distribution, so every allocated byte is equally likely to be the one
+//  sampled, and large allocations are sampled in proportion to size.
+//  Starting again at a different rate discards the samples still held.)
+
+void vlad_heap_profile_start(u_int32_t sample_bytes)
+{
+   // the first backtrace() loads the unwinder, which may call malloc();
+   // get that over with here rather than inside vlad_malloc()
+   void *warm_up[1];
+   backtrace(warm_up, 1);
+   
+   if (profile_seed == 0)
+      profile_seed = ((u_int64_t) getpid() << 32) ^ (u_int64_t) (uintptr_t) &warm_up;
+   
+   u_int32_t rate = (sample_bytes == 0) ? PROFILE_RATE : sample_bytes;
+   
+   // a profile is scaled by a single rate, so samples from an earlier
+   // start are kept only if they were taken at this same rate
+   if (profile_live == 0 || rate != profile_sample_rate){
+      memset(profile_keys, 0xFF, sizeof(profile_keys));
+      profile_live = 0;
+      profile_dropped = 0;
+   }
+   
+   profile_rate = rate;
+   profile_sample_rate = rate;
+   profile_countdown = profile_gap();
+}
+
+// Postcondition: no further samples are taken; samples of blocks that
+//                are still allocated remain in the profile, at the rate
+//                they were taken at
+
+void vlad_heap_profile_stop(void)
+{
+   profile_rate = 0;
+}
+
+// Input: fd, a file descriptor open for writing
+// Output: 0 on success, -1 if a write failed
+// Postcondition: the sampled live blocks have been written to fd as a
+//                heap profile that pprof can read
+
+int vlad_heap_profile_dump(int fd)
+{
+   if (DEBUGGING) printf("CALLED VLAD_HEAP_PROFILE_DUMP\n");
+   
+   char line[32 + PROFILE_DEPTH*20];
+   double sampled_bytes = 0;
+   u_int32_t slot;
+   
+   // profile_keys[] is only set up once sampling has started, and is
+   // not worth scanning while it is empty
+   if (profile_live != 0)
+      for (slot = 0; slot < PROFILE_SLOTS; slot++)
+         if (profile_keys[slot] != PROFILE_EMPTY) sampled_bytes += profile_table[slot].n;
+   
+   // heap_v2 tells pprof how to scale each sample back up by its
+   // probability of being taken at the rate the samples were taken at
+   int length = snprintf(line, sizeof(line), "heap profile: %d: %.0f [ %d: %.0f] @ heap_v2/%d\n",
+                         profile_live, sampled_bytes, profile_live, sampled_bytes,
+                         (profile_sample_rate == 0) ? PROFILE_RATE : profile_sample_rate);
+   if (write_all(fd, line, length) < 0) return -1;
+   
+   for (slot = 0; profile_live != 0 && slot < PROFILE_SLOTS; slot++){
+      if (profile_keys[slot] == PROFILE_EMPTY) continue;
+      profile_sample_t *sample = &profile_table[slot];
+      
+      length = snprintf(line, sizeof(line), "1: %d [1: %d] @", sample->n, sample->n);
+      int frame;
+      for (frame = 0; frame < sample->depth; frame++)
+         length += snprintf(line + length, sizeof(line) - length, " %p", sample->stack[frame]);
+      length += snprintf(line + length, sizeof(line) - length, "\n");
+      if (write_all(fd, line, length) < 0) return -1;
+   }
+   
+   if (profile_dropped != 0)
+      fprintf(stderr, "vlad_heap_profile_dump: %d samples dropped, profile table full\n",
+              profile_dropped);
+   
+   // pprof needs the address space layout to turn addresses into symbols
+   length = snprintf(line, sizeof(line), "\nMAPPED_LIBRARIES:\n");
+   if (write_all(fd, line, length) < 0) return -1;
+   
+   int maps = open("/proc/self/maps", O_RDONLY);
+   if (maps >= 0){
+      ssize_t got;
+      while ((got = read(maps, line, sizeof(line))) > 0){
+         if (write_all(fd, line, got) < 0){
+            close(maps);
+            return -1;
+         }
+      }
+      close(maps);
+   }
+   
+   return 0;
+}
+
+// Records the caller's stack against the block whose header is at
+// memory[region], then picks the distance to the next sample
+
+static void profile_record(vaddr_t region, u_int32_t n)
+{
+   profile_countdown = profile_gap();
+   
+   // keep the table at most 3/4 full so probes stay short
+   if (profile_live >= PROFILE_SLOTS/4*3){
+      profile_dropped++;
+      return;
+   }
+   
+   u_int32_t slot = profile_home(region);
+   while (profile_keys[slot] != PROFILE_EMPTY)
+      slot = (slot + 1) & (PROFILE_SLOTS - 1);
+   
+   profile_sample_t *sample = &profile_table[slot];
+   void *stack[PROFILE_DEPTH + 1];
+   int depth = backtrace(stack, PROFILE_DEPTH + 1);
+   
+   // leave out this function's own frame
+   sample->depth = (depth > 1) ? depth - 1 : 0;
+   memcpy(sample->stack, stack + 1, sample->depth*sizeof(void *));
+   sample->n = n;
+   profile_keys[slot] = region;
+   profile_live++;
+}
+
+// Removes the sample for the block at memory[region], if there is one
+
+static void profile_forget(vaddr_t region)
+{
+   u_int32_t hole = profile_home(region);
+   while (profile_keys[hole] != PROFILE_EMPTY && profile_keys[hole] != region)
+      hole = (hole + 1) & (PROFILE_SLOTS - 1);
+   if (profile_keys[hole] == PROFILE_EMPTY) return;
+   
+   // shift later samples in the same probe run back into the hole, so
+   // lookups never need to skip over deleted slots
+   u_int32_t slot = hole;
+   while (TRUE){
+      slot = (slot + 1) & (PROFILE_SLOTS - 1);
+      if (profile_keys[slot] == PROFILE_EMPTY) break;
+      
+      u_int32_t home = profile_home(profile_keys[slot]);
+      int stays = (hole < slot) ? (home > hole && home <= slot) : (home > hole || home <= slot);
+      if (stays) continue;
+      
+      profile_keys[hole] = profile_keys[slot];
+      profile_table[hole] = profile_table[slot];
+      hole = slot;
+   }
+   
+   profile_keys[hole] = PROFILE_EMPTY;
+   profile_live--;
+}
+
+// Returns the slot in profile_keys[] where a search for region starts.
+// Block indexes are multiples of 4 (of 16 under the shim), so the low
+// bits of the product are always zero; the slot comes from the high bits.
+
+static u_int32_t profile_home(vaddr_t region)
+{
+   return (region * 2654435761u) >> (32 - PROFILE_BITS);
+}
+
+// Returns a random number of bytes to allocate before the next sample,
+// exponentially distributed with mean profile_rate
+
+static int64_t profile_gap(void)
+{
+   // xorshift64
+   profile_seed ^= profile_seed << 13;
+   profile_seed ^= profile_seed >> 7;
+   profile_seed ^= profile_seed << 17;
+   
+   // uniform in (0, 1], so the log is finite
+   double u = ((profile_seed >> 11) + 1) / 9007199254740992.0;
+   return (int64_t) (-log(u) * profile_rate) + 1;
+}
+
+// Writes all n bytes of buf to fd, retrying short writes;
+// returns 0 on success and -1 on failure
+
+static int write_all(int fd, void *buf, size_t n)
+{
+   byte *next = (byte *) buf;
+   while (n > 0){
+      ssize_t done = write(fd, next, n);
+      if (done < 0){
+         if (errno == EINTR) continue;
+         return -1;
+      }
+      next += done;
+      n -= done;
+   }
+   return 0;
+}
+
 // Helper function which returns 1 is num is a sole power of 2 and
 // returns 0 if it is not
 int isPowerOf2(int num){
@@ -0,0 +1,52 @@
+//
+//  COMP1927 Assignment 1 - Vlad: the memory allocator
+//  allocator.h ... interface
+//
+//  Created by Liam O'Connor on 18/07/12.
+//  Modified by John Shepherd in August 2014
+//  Copyright (c) 2012-2014 UNSW. All rights reserved.
+//
+
+#ifndef _ALLOCATOR_H_
+#define _ALLOCATOR_H_
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+// Initialise the allocator with (at least) size bytes of memory
+void vlad_init(u_int32_t size);
+
+// Allocate a region of (at least) n bytes; NULL if none is available
+void *vlad_malloc(u_int32_t n);
+
+// As vlad_malloc(nmemb * size), with the region cleared to zero
+void *vlad_calloc(u_int32_t nmemb, u_int32_t size);
+
+// Return a region obtained from vlad_malloc() to the free list
+void vlad_free(void *object);
+
+// As vlad_free(), for a region the caller knows holds n bytes
+void vlad_free_sized(void *object, u_int32_t n);
+
+// Number of bytes actually usable in a region from vlad_malloc()
+u_int32_t vlad_usable_size(void *object);
+
+// Release all memory held by the allocator
+void vlad_end(void);
+
+// Print the allocator's current state on stdout
+void vlad_stats(void);
+
+// Write a binary description of every region to fd (see vlad_snapshot.h)
+int vlad_snapshot(int fd);
+
+// Sample about one allocation per sample_bytes (0 for the default) ...
+void vlad_heap_profile_start(u_int32_t sample_bytes);
+
+// ... until this is called
+void vlad_heap_profile_stop(void);
+
+// Write the sampled live allocations to fd in pprof's heap profile format
+int vlad_heap_profile_dump(int fd);
+
+#endif
@@ -0,0 +1,141 @@
+//
+//  COMP1927 Assignment 1 - Vlad: the memory allocator
+//  bench_containers.cpp ... STL container churn, Vlad vs std::allocator
+//
+//  Build and run:
+//
+//    gcc -O2 -c allocator.c
+//    g++ -std=c++17 -O2 -o bench_containers bench_containers.cpp allocator.o -lm
+//    ./bench_containers [live_keys] [operations]
+//
+//  Each run keeps roughly live_keys entries in the container and then
+//  performs random insert/erase pairs on it, which is the allocation
+//  pattern of a node-based container under steady load.
+//
+//  Every run on the Vlad heap starts from a freshly initialised heap. The
+//  heap profiler rows are measured ROUNDS times, alternating with the
+//  same run without the profiler, and the medians are reported.
+//
+
+#include "vlad_allocator.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <utility>
+
+#define HEAP_SIZE     (64u*1024*1024)
+#define LIVE_KEYS     10000
+#define OPERATIONS    200000
+#define ROUNDS        7
+
+typedef std::pair<const int, int> entry_t;
+typedef std::map<int, int, std::less<int>, VladAllocator<entry_t>> vlad_map_t;
+typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                           VladAllocator<entry_t>> vlad_hash_t;
+
+// Fills m with live keys, then does ops random erase + insert pairs.
+// Returns nanoseconds per operation.
+
+template <typename Map>
+static double churn(Map &m, int live, int ops)
+{
+   std::mt19937 rng(1927);
+   std::uniform_int_distribution<int> key(0, 2*live);
+
+   auto start = std::chrono::steady_clock::now();
+   for (int i = 0; i < live; i++) m.emplace(key(rng), i);
+   for (int i = 0; i < ops; i++) {
+      m.erase(key(rng));
+      m.emplace(key(rng), i);
+   }
+   auto stop = std::chrono::steady_clock::now();
+
+   double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+   return ns / (live + 2.0*ops);
+}
+
+// As churn(), on a fresh Vlad heap and with the heap profiler on if asked.
+// size is set to the number of entries left in the container.
+
+template <typename Map, typename... Args>
+static double vlad_churn(int live, int ops, bool profile, size_t &size, Args&&... args)
+{
+   vlad_end();
+   vlad_init(HEAP_SIZE);
+
+   Map m(std::forward<Args>(args)...);
+   if (profile) vlad_heap_profile_start(0);
+   double ns = churn(m, live, ops);
+   if (profile) vlad_heap_profile_stop();
+
+   size = m.size();
+   return ns;
+}
+
+static double median(double *ns, int n)
+{
+   std::sort(ns, ns + n);
+   return (n % 2 == 1) ? ns[n/2] : (ns[n/2 - 1] + ns[n/2]) / 2;
+}
+
+static void report(const char *name, double ns, size_t size)
+{
+   printf("%-48s %8.1f ns/op   (%zu live)\n", name, ns, size);
+}
+
+// Alternates runs with the profiler off and on, so that both see the
+// same machine state, and reports the median of each
+
+template <typename Map>
+static void profiler_overhead(const char *off_name, const char *on_name, int live, int ops)
+{
+   double off[ROUNDS], on[ROUNDS];
+   size_t size;
+   for (int round = 0; round < ROUNDS; round++) {
+      off[round] = vlad_churn<Map>(live, ops, false, size);
+      on[round] = vlad_churn<Map>(live, ops, true, size);
+   }
+
+   double off_ns = median(off, ROUNDS), on_ns = median(on, ROUNDS);
+   report(off_name, off_ns, size);
+   report(on_name, on_ns, size);
+   printf("%-48s %+7.1f%%\n", "  profiler overhead", 100.0*(on_ns - off_ns)/off_ns);
+}
+
+int main(int argc, char *argv[])
+{
+   int live = (argc > 1) ? atoi(argv[1]) : LIVE_KEYS;
+   int ops = (argc > 2) ? atoi(argv[2]) : OPERATIONS;
+
+   VladMemoryResource vlad;
+   size_t size;
+   double ns;
+
+   {
+      std::map<int, int> m;
+      ns = churn(m, live, ops);
+      report("std::map / std::allocator", ns, m.size());
+   }
+   profiler_overhead<vlad_map_t>("std::map / VladAllocator",
+                                 "std::map / VladAllocator, heap profiler on", live, ops);
+   ns = vlad_churn<std::pmr::map<int, int>>(live, ops, false, size, &vlad);
+   report("std::pmr::map / VladMemoryResource", ns, size);
+
+   {
+      std::unordered_map<int, int> m;
+      ns = churn(m, live, ops);
+      report("std::unordered_map / std::allocator", ns, m.size());
+   }
+   profiler_overhead<vlad_hash_t>("std::unordered_map / VladAllocator",
+                                  "std::unordered_map / VladAllocator, profiler on", live, ops);
+   ns = vlad_churn<std::pmr::unordered_map<int, int>>(live, ops, false, size, &vlad);
+   report("std::pmr::unordered_map / VladMemoryResource", ns, size);
+
+   vlad_end();
+   return EXIT_SUCCESS;
+}
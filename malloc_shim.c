@@ -0,0 +1,323 @@
+//
+//  COMP1927 Assignment 1 - Vlad: the memory allocator
+//  malloc_shim.c ... malloc()/free() replacement on top of Vlad
+//
+//  Build as a shared library and preload it to run an unmodified
+//  program on the Vlad heap:
+//
+//    gcc -Wall -O2 -shared -fPIC -o libvlad.so malloc_shim.c allocator.c -lpthread -lm
+//    VLAD_HEAP_SIZE=268435456 LD_PRELOAD=./libvlad.so ./some_program
+//
+//  VLAD_HEAP_SIZE (bytes, rounded up to a power of 2 by vlad_init) is
+//  optional and defaults to SHIM_HEAP_SIZE.
+//
+
+#define _GNU_SOURCE
+#include "allocator.h"
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define SHIM_HEAP_SIZE    (64u*1024*1024)  // heap size if VLAD_HEAP_SIZE is not set
+#define SHIM_HEAP_MAX     (1u << 31)       // largest power of 2 a u_int32_t size can hold
+#define SHIM_ALIGN        16               // alignment of every pointer handed out
+#define VLAD_HEADER_SIZE  8                // sizeof(alloc_header_t) in allocator.c
+#define SHIM_OVERHEAD     (VLAD_HEADER_SIZE + sizeof(shim_tag_t))
+#define MAGIC_SHIM        0xFEEDBEEF
+#define MAGIC_MAPPED      0xFEEDDEAD
+
+#define TRUE              1
+#define FALSE             0
+
+typedef unsigned char byte;
+
+// Sits immediately before every pointer carved out of the Vlad heap
+typedef struct shim_tag {
+   u_int32_t offset;  // # bytes back to the tag at the start of the block
+   u_int32_t magic;   // ought to contain MAGIC_SHIM
+} shim_tag_t;
+
+// Sits immediately before every pointer mmap'd directly; magic lines up
+// with shim_tag_t.magic so either kind can be checked from the pointer
+typedef struct map_header {
+   void *base;        // start of the mapping
+   size_t length;     // # bytes in the mapping
+   size_t usable;     // # bytes the client may use
+   u_int32_t unused;
+   u_int32_t magic;   // ought to contain MAGIC_MAPPED
+} map_header_t;
+
+// Global data
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int heap_ready = FALSE;   // vlad_init() has been called
+static byte *heap_start = NULL;  // the chunk vlad_init() got from us
+static size_t heap_length;       // # bytes in that chunk
+
+// set while this thread is inside shim_init(), so that the malloc()
+// vlad_init() makes comes straight from mmap instead of recursing
+static __thread int in_init __attribute__((tls_model("initial-exec")));
+
+// Private functions
+
+static void shim_init(void);
+static void *shim_alloc(size_t n, size_t align, int zero);
+static void *heap_alloc(size_t n, size_t align, int zero);
+static void *map_alloc(size_t n, size_t align);
+static void *map_raw(size_t n);
+static void map_free(void *p);
+static int in_heap(void *p);
+static void corrupt(const char *msg);
+static void fork_prepare(void);
+static void fork_release(void);
+
+
+void *malloc(size_t n)
+{
+   void *p = shim_alloc(n, SHIM_ALIGN, FALSE);
+   if (p == NULL) errno = ENOMEM;
+   return p;
+}
+
+void free(void *p)
+{
+   if (p == NULL) return;
+
+   if (in_heap(p)) {
+      shim_tag_t *tag = (shim_tag_t *) p - 1;
+      if (tag->magic != MAGIC_SHIM) corrupt("free: Attempt to free non-allocated memory\n");
+      pthread_mutex_lock(&lock);
+      vlad_free((byte *) tag - tag->offset);
+      pthread_mutex_unlock(&lock);
+   } else {
+      map_free(p);
+   }
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+   if (size != 0 && nmemb > SIZE_MAX / size) {
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   // heap blocks come from vlad_calloc(), which only clears what has
+   // been written before; anything else is a fresh, already zero mapping
+   void *p = shim_alloc(nmemb * size, SHIM_ALIGN, TRUE);
+   if (p == NULL) errno = ENOMEM;
+   return p;
+}
+
+void *realloc(void *p, size_t n)
+{
+   if (p == NULL) return malloc(n);
+   if (n == 0) {
+      free(p);
+      return NULL;
+   }
+
+   // the existing block may already have enough slack
+   size_t have = malloc_usable_size(p);
+   if (n <= have) return p;
+
+   void *q = malloc(n);
+   if (q == NULL) return NULL;
+   memcpy(q, p, have);
+   free(p);
+   return q;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t n)
+{
+   if (align == 0 || (align & (align - 1)) != 0 || align % sizeof(void *) != 0)
+      return EINVAL;
+
+   void *p = shim_alloc(n, align, FALSE);
+   if (p == NULL) return ENOMEM;
+
+   *memptr = p;
+   return 0;
+}
+
+void *aligned_alloc(size_t align, size_t n)
+{
+   void *p = NULL;
+   int err = posix_memalign(&p, (align < sizeof(void *)) ? sizeof(void *) : align, n);
+   if (err != 0) errno = err;
+   return p;
+}
+
+void *memalign(size_t align, size_t n)
+{
+   return aligned_alloc(align, n);
+}
+
+void *valloc(size_t n)
+{
+   return aligned_alloc(sysconf(_SC_PAGESIZE), n);
+}
+
+size_t malloc_usable_size(void *p)
+{
+   if (p == NULL) return 0;
+
+   // Vlad may have handed out a whole free region, which realloc() can
+   // then grow into
+   if (in_heap(p)) {
+      shim_tag_t *tag = (shim_tag_t *) p - 1;
+      return vlad_usable_size((byte *) tag - tag->offset) - tag->offset - sizeof(shim_tag_t);
+   }
+   return ((map_header_t *) p - 1)->usable;
+}
+
+
+// Sets up the Vlad heap on first use. Called with lock held.
+
+static void shim_init(void)
+{
+   u_int32_t size = SHIM_HEAP_SIZE;
+
+   char *env = getenv("VLAD_HEAP_SIZE");
+   if (env != NULL) {
+      unsigned long request = strtoul(env, NULL, 0);
+      if (request >= 1024 && request <= SHIM_HEAP_MAX) size = request;
+   }
+
+   in_init = TRUE;
+   vlad_init(size);
+
+   // anything pthread_atfork() allocates is served by mmap while in_init
+   // is still set, since lock is held
+   pthread_atfork(fork_prepare, fork_release, fork_release);
+   in_init = FALSE;
+
+   heap_ready = TRUE;
+}
+
+static void *shim_alloc(size_t n, size_t align, int zero)
+{
+   if (in_init) {
+      // the first request made while initialising is vlad_init()'s own chunk
+      if (heap_start == NULL) {
+         heap_start = map_raw(n);
+         heap_length = (heap_start == NULL) ? 0 : n;
+         return heap_start;
+      }
+      return map_alloc(n, align);
+   }
+
+   pthread_mutex_lock(&lock);
+   if (!heap_ready) shim_init();
+   void *p = heap_alloc(n, align, zero);
+   pthread_mutex_unlock(&lock);
+
+   // requests too big for the heap, or that arrive once it is full,
+   // are mapped directly rather than failing
+   if (p == NULL) p = map_alloc(n, align);
+   return p;
+}
+
+// Carves n bytes, zeroed if asked, whose client pointer is a multiple of
+// align out of the Vlad heap. Called with lock held. Returns NULL if the
+// heap cannot satisfy the request.
+
+static void *heap_alloc(size_t n, size_t align, int zero)
+{
+   // stricter alignments over-allocate by enough to move the client
+   // pointer up to the next multiple of align
+   size_t slack = (align > SHIM_ALIGN) ? align - SHIM_ALIGN : 0;
+   if (slack > heap_length || n > heap_length - slack) return NULL;
+
+   // every block is kept a multiple of SHIM_ALIGN and the heap itself is
+   // page aligned, so the tag after Vlad's header always ends on a
+   // SHIM_ALIGN boundary
+   size_t block = (n + slack + SHIM_OVERHEAD + SHIM_ALIGN - 1) & ~(size_t) (SHIM_ALIGN - 1);
+   if (block > heap_length - SHIM_ALIGN) return NULL;
+
+   u_int32_t request = block - VLAD_HEADER_SIZE;
+   shim_tag_t *tag = zero ? vlad_calloc(1, request) : vlad_malloc(request);
+   if (tag == NULL) return NULL;
+
+   tag->offset = 0;
+   tag->magic = MAGIC_SHIM;
+   if (slack == 0) return tag + 1;
+
+   // a second tag, just before the aligned pointer, leads back to the
+   // first; both pointers are multiples of SHIM_ALIGN, so if they differ
+   // the second tag lies inside the block
+   uintptr_t start = ((uintptr_t) (tag + 1) + align - 1) & ~(uintptr_t) (align - 1);
+   shim_tag_t *aligned = (shim_tag_t *) start - 1;
+   aligned->offset = (byte *) aligned - (byte *) tag;
+   aligned->magic = MAGIC_SHIM;
+   return aligned + 1;
+}
+
+// Maps a block of n bytes whose client pointer is a multiple of align
+
+static void *map_alloc(size_t n, size_t align)
+{
+   size_t page = sysconf(_SC_PAGESIZE);
+   if (align < SHIM_ALIGN) align = SHIM_ALIGN;
+
+   if (n > SIZE_MAX - sizeof(map_header_t) - align - page) return NULL;
+   size_t length = (sizeof(map_header_t) + align + n + page - 1) & ~(page - 1);
+
+   byte *base = map_raw(length);
+   if (base == NULL) return NULL;
+
+   uintptr_t start = (uintptr_t) base + sizeof(map_header_t);
+   start = (start + align - 1) & ~(uintptr_t) (align - 1);
+
+   map_header_t *header = (map_header_t *) start - 1;
+   header->base = base;
+   header->length = length;
+   header->usable = (uintptr_t) base + length - start;
+   header->magic = MAGIC_MAPPED;
+   return (void *) start;
+}
+
+static void *map_raw(size_t n)
+{
+   void *p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   return (p == MAP_FAILED) ? NULL : p;
+}
+
+static void map_free(void *p)
+{
+   map_header_t *header = (map_header_t *) p - 1;
+   if (header->magic != MAGIC_MAPPED) corrupt("free: Attempt to free non-allocated memory\n");
+
+   header->magic = 0;
+   munmap(header->base, header->length);
+}
+
+static int in_heap(void *p)
+{
+   return heap_start != NULL && (byte *) p >= heap_start && (byte *) p < heap_start + heap_length;
+}
+
+// stdio may allocate, so errors are written out directly
+
+static void corrupt(const char *msg)
+{
+   ssize_t rc = write(STDERR_FILENO, msg, strlen(msg));
+   (void) rc;
+   abort();
+}
+
+// Hold the lock across fork() so the child never sees the heap mid-update
+
+static void fork_prepare(void)
+{
+   pthread_mutex_lock(&lock);
+}
+
+static void fork_release(void)
+{
+   pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,140 @@
+//
+//  COMP1927 Assignment 1 - Vlad: the memory allocator
+//  vlad_allocator.hpp ... C++ adapters for the Vlad heap
+//
+//  VladAllocator<T> meets the standard Allocator requirements, and
+//  VladMemoryResource is a std::pmr::memory_resource, so STL containers
+//  can be placed on the Vlad heap:
+//
+//    vlad_init(1 << 24);
+//    std::map<int, int, std::less<int>,
+//             VladAllocator<std::pair<const int, int>>> m;
+//
+//    VladMemoryResource vlad;
+//    std::pmr::unordered_map<int, int> h(&vlad);
+//
+//  Both share the single heap set up by vlad_init(); it must outlive
+//  every container using it.
+//
+
+#ifndef _VLAD_ALLOCATOR_HPP_
+#define _VLAD_ALLOCATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory_resource>
+
+extern "C" {
+#include "allocator.h"
+}
+
+// Vlad rounds every block up to a multiple of 4 bytes behind an 8 byte
+// header, so 4 is all the alignment a bare vlad_malloc() promises
+#define VLAD_MIN_ALIGN 4
+
+// Largest request whose header and round-up still fit in a u_int32_t;
+// anything bigger would wrap inside vlad_malloc()
+#define VLAD_MAX_REQUEST (UINT32_MAX - 8 - 3)
+
+namespace vlad_detail {
+
+// Input: n - number of bytes, align - required alignment (a power of 2)
+// Output: pointer to n bytes aligned to align; throws std::bad_alloc
+//         if the heap cannot satisfy the request
+
+inline void *allocate(std::size_t n, std::size_t align)
+{
+   if (align <= VLAD_MIN_ALIGN) {
+      if (n > VLAD_MAX_REQUEST) throw std::bad_alloc();
+      void *p = vlad_malloc(n);
+      if (p == nullptr) throw std::bad_alloc();
+      return p;
+   }
+
+   // over-allocate, then record how far the aligned pointer is from the
+   // start of the region in the 4 bytes just before it
+   if (align > VLAD_MAX_REQUEST || n > VLAD_MAX_REQUEST - align) throw std::bad_alloc();
+   unsigned char *raw = static_cast<unsigned char *>(vlad_malloc(n + align));
+   if (raw == nullptr) throw std::bad_alloc();
+
+   std::uintptr_t start = reinterpret_cast<std::uintptr_t>(raw) + VLAD_MIN_ALIGN;
+   start = (start + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+
+   unsigned char *p = reinterpret_cast<unsigned char *>(start);
+   reinterpret_cast<u_int32_t *>(p)[-1] = p - raw;
+   return p;
+}
+
+// Input: p, n, align - exactly as passed to / returned by allocate()
+// Postcondition: the region holding p is back on Vlad's free list
+//                (n is checked against the region when CHECKING is on)
+
+inline void deallocate(void *p, std::size_t n, std::size_t align) noexcept
+{
+   if (align <= VLAD_MIN_ALIGN) {
+      vlad_free_sized(p, n);
+      return;
+   }
+
+   u_int32_t offset = reinterpret_cast<u_int32_t *>(p)[-1];
+   vlad_free_sized(static_cast<unsigned char *>(p) - offset, n + align);
+}
+
+}  // namespace vlad_detail
+
+
+template <typename T>
+class VladAllocator {
+public:
+   typedef T value_type;
+
+   VladAllocator() noexcept {}
+   template <typename U> VladAllocator(const VladAllocator<U> &) noexcept {}
+
+   T *allocate(std::size_t n)
+   {
+      if (n > SIZE_MAX / sizeof(T)) throw std::bad_array_new_length();
+      return static_cast<T *>(vlad_detail::allocate(n * sizeof(T), alignof(T)));
+   }
+
+   void deallocate(T *p, std::size_t n) noexcept
+   {
+      vlad_detail::deallocate(p, n * sizeof(T), alignof(T));
+   }
+};
+
+// there is only one Vlad heap, so any two allocators are interchangeable
+
+template <typename T, typename U>
+bool operator==(const VladAllocator<T> &, const VladAllocator<U> &) noexcept
+{
+   return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const VladAllocator<T> &, const VladAllocator<U> &) noexcept
+{
+   return false;
+}
+
+
+class VladMemoryResource : public std::pmr::memory_resource {
+protected:
+   void *do_allocate(std::size_t n, std::size_t align) override
+   {
+      return vlad_detail::allocate(n, align);
+   }
+
+   void do_deallocate(void *p, std::size_t n, std::size_t align) override
+   {
+      vlad_detail::deallocate(p, n, align);
+   }
+
+   bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+   {
+      return dynamic_cast<const VladMemoryResource *>(&other) != nullptr;
+   }
+};
+
+#endif
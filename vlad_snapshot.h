@@ -0,0 +1,31 @@
+//
+//  COMP1927 Assignment 1 - Vlad: the memory allocator
+//  vlad_snapshot.h ... format of the heap snapshots from vlad_snapshot()
+//
+//  A snapshot is a snapshot_header_t followed by one snapshot_record_t per
+//  region, in memory[] order, and ends with a record whose size is 0.
+//  All fields are in the byte order of the machine that wrote them.
+//
+
+#ifndef _VLAD_SNAPSHOT_H_
+#define _VLAD_SNAPSHOT_H_
+
+#include <sys/types.h>
+
+#define SNAPSHOT_MAGIC    0x53444C56  // "VLDS" on a little-endian machine
+#define SNAPSHOT_VERSION  1
+#define SNAPSHOT_FREE     1           // set in a record's size for free regions
+
+typedef struct snapshot_header {
+   u_int32_t magic;          // ought to contain SNAPSHOT_MAGIC
+   u_int32_t version;        // SNAPSHOT_VERSION
+   u_int32_t memory_size;    // number of bytes in memory[]
+   u_int32_t free_list_ptr;  // index in memory[] of first block in free list
+} snapshot_header_t;
+
+typedef struct snapshot_record {
+   u_int32_t offset;  // index in memory[] of the region's header
+   u_int32_t size;    // # bytes in region (a multiple of 4), | SNAPSHOT_FREE
+} snapshot_record_t;
+
+#endif
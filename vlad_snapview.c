@@ -0,0 +1,174 @@
+//
+//  COMP1927 Assignment 1 - Vlad: the memory allocator
+//  vlad_snapview.c ... offline viewer for vlad_snapshot() output
+//
+//  Build and run:
+//
+//    gcc -Wall -o vlad_snapview vlad_snapview.c
+//    ./vlad_snapview heap.snap      (or read the snapshot from stdin)
+//
+//  Prints a summary of the heap, a histogram of free region sizes, and
+//  a 2-d occupancy map of memory[]. Records are processed as they are
+//  read, so snapshots of any size can be viewed in constant space.
+//
+
+#include "vlad_snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAP_ROWS       32
+#define MAP_COLS       64
+#define NUM_BUCKETS    32    // free size histogram buckets, one per power of 2
+#define BAR_WIDTH      40    // widest histogram bar
+
+#define TRUE           1
+#define FALSE          0
+
+typedef struct bucket {
+   u_int32_t regions;        // # free regions with size in [2^i, 2^(i+1))
+   double bytes;             // total size of those regions
+} bucket_t;
+
+static int log2_floor(u_int32_t n);
+static void mark_cells(double *cells, double cell_size, u_int32_t offset, u_int32_t size);
+
+
+int main(int argc, char *argv[])
+{
+   FILE *in = stdin;
+   if (argc > 1){
+      in = fopen(argv[1], "rb");
+      if (in == NULL){
+         perror(argv[1]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   snapshot_header_t header;
+   if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != SNAPSHOT_MAGIC){
+      fprintf(stderr, "vlad_snapview: Not a Vlad snapshot\n");
+      return EXIT_FAILURE;
+   }
+   if (header.version != SNAPSHOT_VERSION){
+      fprintf(stderr, "vlad_snapview: Unsupported snapshot version %d\n", header.version);
+      return EXIT_FAILURE;
+   }
+   // vlad_init() always rounds memory[] up to a power of 2
+   if (header.memory_size == 0 || (header.memory_size & (header.memory_size - 1)) != 0){
+      fprintf(stderr, "vlad_snapview: Bad heap size %u\n", header.memory_size);
+      return EXIT_FAILURE;
+   }
+
+   // each cell of the map accumulates how many of its bytes are allocated
+   double cells[MAP_ROWS*MAP_COLS] = {0};
+   double cell_size = (double) header.memory_size / (MAP_ROWS*MAP_COLS);
+
+   bucket_t buckets[NUM_BUCKETS] = {{0}};
+   u_int32_t num_free = 0, num_alloc = 0;
+   double free_bytes = 0, alloc_bytes = 0;
+   u_int32_t largest_free = 0;
+
+   snapshot_record_t record;
+   int finished = FALSE;
+   while (fread(&record, sizeof(record), 1, in) == 1){
+      if (record.size == 0){
+         finished = TRUE;
+         break;
+      }
+
+      u_int32_t size = record.size & ~SNAPSHOT_FREE;
+      if (record.offset > header.memory_size || size > header.memory_size - record.offset){
+         fprintf(stderr, "vlad_snapview: Region at %u of %u bytes runs past the end of the heap\n",
+                 record.offset, size);
+         return EXIT_FAILURE;
+      }
+
+      if (record.size & SNAPSHOT_FREE){
+         num_free++;
+         free_bytes += size;
+         if (size > largest_free) largest_free = size;
+
+         int b = log2_floor(size);
+         buckets[b].regions++;
+         buckets[b].bytes += size;
+      } else {
+         num_alloc++;
+         alloc_bytes += size;
+         mark_cells(cells, cell_size, record.offset, size);
+      }
+   }
+   if (!finished)
+      fprintf(stderr, "vlad_snapview: Snapshot is truncated, showing what was read\n");
+
+   // summary
+   printf("heap: %u bytes, %u regions (%u free, %u allocated)\n",
+          header.memory_size, num_free + num_alloc, num_free, num_alloc);
+   printf("allocated: %.0f bytes (%.1f%%)\n", alloc_bytes, 100.0*alloc_bytes/header.memory_size);
+   printf("free: %.0f bytes, largest region %u bytes", free_bytes, largest_free);
+   if (free_bytes > 0)
+      printf(", fragmentation %.1f%%", 100.0*(1.0 - largest_free/free_bytes));
+   printf("\n\n");
+
+   // histogram of free region sizes, bars scaled by bytes
+   double most = 0;
+   int b;
+   for (b = 0; b < NUM_BUCKETS; b++)
+      if (buckets[b].bytes > most) most = buckets[b].bytes;
+
+   printf("free region sizes:\n");
+   if (num_free == 0) printf("  (none)\n");
+   for (b = 0; b < NUM_BUCKETS; b++){
+      if (buckets[b].regions == 0) continue;
+
+      int bar = (int) (BAR_WIDTH*buckets[b].bytes/most + 0.5);
+      printf("  %10u - %10u : %6u regions %12.0f bytes  ",
+             1u << b, (b == 31) ? 0xFFFFFFFF : (1u << (b+1)) - 1, buckets[b].regions, buckets[b].bytes);
+      while (bar-- > 0) putchar('#');
+      putchar('\n');
+   }
+
+   // occupancy map
+   printf("\noccupancy map (one cell = %.0f bytes; '#' allocated, '+' partly, '.' free):\n",
+          cell_size);
+   int row, col;
+   for (row = 0; row < MAP_ROWS; row++){
+      printf("  %10u |", (u_int32_t) (row*MAP_COLS*cell_size));
+      for (col = 0; col < MAP_COLS; col++){
+         double used = cells[row*MAP_COLS + col];
+         putchar((used <= 0) ? '.' : (used >= cell_size) ? '#' : '+');
+      }
+      printf("|\n");
+   }
+
+   if (in != stdin) fclose(in);
+   return EXIT_SUCCESS;
+}
+
+// Returns the index of the highest set bit in n (n > 0)
+
+static int log2_floor(u_int32_t n)
+{
+   int bits = 0;
+   while (n > 1){
+      n >>= 1;
+      bits++;
+   }
+   return bits;
+}
+
+// Adds the allocated region [offset, offset+size) to the cells it covers
+
+static void mark_cells(double *cells, double cell_size, u_int32_t offset, u_int32_t size)
+{
+   double start = offset;
+   double end = (double) offset + size;
+
+   int cell = (int) (start/cell_size);
+   while (cell < MAP_ROWS*MAP_COLS && start < end){
+      double cell_end = (cell + 1)*cell_size;
+      double stop = (end < cell_end) ? end : cell_end;
+      cells[cell] += stop - start;
+      start = stop;
+      cell++;
+   }
+}